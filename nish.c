@@ -1,16 +1,35 @@
+#define _GNU_SOURCE
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <readline/history.h>
 #include <readline/readline.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+// how much a relay asks splice to move at once, it only ever moves what is
+// sitting in the pipe so this just needs to be at least the pipe size
+#define RELAY_CHUNK (16 << 20)
+// how long, in ms, relays get to finish up once every stage has exited
+#define RELAY_GRACE_MS 100
+
+// filled in by a pipe relay, lives in shared memory so the shell can read it
+// once the job is done
+typedef struct pipe_stat {
+  int active;
+  unsigned long long bytes;
+  long long nsec;
+} pipe_stat_t;
+
 typedef struct job {
   int *pid;
   int background;
@@ -20,6 +39,11 @@ typedef struct job {
   int *arg_num;
   char ***arg_list;
   int can_be_removed;
+  // relays sitting between the stages when pipestats is on, pipe_stats has
+  // num_progs - 1 entries, one per pipe
+  int num_relays;
+  pid_t *relay_pid;
+  pipe_stat_t *pipe_stats;
 } job_t;
 
 char *cwd;
@@ -29,6 +53,16 @@ pid_t shell_pgid;
 int num_jobs = 0;
 int shell_terminal;
 int batch_mode = 0;
+// set by -c or -s, no readline, history or terminal control in these modes
+int non_interactive = 0;
+// exit status of the last foreground job, what -c and -s exit with
+int last_status = 0;
+// set through the set builtin, pipe_size of 0 leaves the kernel default
+int pipe_size = 0;
+int pipe_stats = 0;
+// so a pipe we couldn't grow gets mentioned once per command line, not once
+// per pipe
+int pipe_size_warned = 0;
 
 void job_deconstructor(job_t *ptr) {
   // check if the job is null
@@ -60,6 +94,84 @@ void job_deconstructor(job_t *ptr) {
   if (ptr->arg_num != NULL) {
     free(ptr->arg_num);
   }
+  // relays of a job that never got reported, don't block on them since the
+  // job could still be running when we exit
+  if (ptr->relay_pid != NULL) {
+    for (int i = 0; i < ptr->num_relays; i++) {
+      int stat = -10;
+      waitpid(ptr->relay_pid[i], &stat, WNOHANG);
+    }
+    free(ptr->relay_pid);
+    ptr->relay_pid = NULL;
+  }
+  if (ptr->pipe_stats != NULL) {
+    munmap(ptr->pipe_stats, sizeof(pipe_stat_t) * (ptr->num_progs - 1));
+    ptr->pipe_stats = NULL;
+  }
+}
+
+// waits on the relays of a finished job and prints how much went through
+// each pipe and how fast, then lets go of the shared memory
+void report_pipe_stats(job_t *job) {
+  if (job->pipe_stats == NULL) {
+    return;
+  }
+  // every stage is gone so the relays should be right behind them, but
+  // something the stages left running (a daemon, a stray sleep &) can still
+  // hold one of our pipes open, so only give them so long
+  int remaining = job->num_relays;
+  for (int ms = 0; remaining > 0 && ms < RELAY_GRACE_MS; ms++) {
+    for (int i = 0; i < job->num_relays; i++) {
+      int stat = -10;
+      if (job->relay_pid[i] > 0 &&
+          waitpid(job->relay_pid[i], &stat, WNOHANG) != 0) {
+        job->relay_pid[i] = 0;
+        remaining -= 1;
+      }
+    }
+    if (remaining > 0) {
+      usleep(1000);
+    }
+  }
+  // the counts are already in shared memory, so nothing is lost by this
+  for (int i = 0; i < job->num_relays; i++) {
+    if (job->relay_pid[i] > 0) {
+      int stat = -10;
+      kill(job->relay_pid[i], SIGKILL);
+      waitpid(job->relay_pid[i], &stat, 0);
+    }
+  }
+  job->num_relays = 0;
+  int pipe_num = 0;
+  for (int i = 0; i < job->num_progs - 1; i++) {
+    pipe_stat_t *stat = &job->pipe_stats[i];
+    if (!stat->active) {
+      continue;
+    }
+    pipe_num += 1;
+    // empty stages get skipped over, so the pipe feeds whichever real stage
+    // comes next, if any
+    char *from = job->arg_list[i][0];
+    char *to = "nothing";
+    for (int j = i + 1; j < job->num_progs; j++) {
+      if (job->arg_num[j] > 0) {
+        to = job->arg_list[j][0];
+        break;
+      }
+    }
+    // everything arrived in one chunk, too quick for a meaningful rate
+    if (stat->nsec == 0) {
+      dprintf(2, "pipe %i (%s -> %s): %llu bytes\n", pipe_num, from, to,
+              stat->bytes);
+      continue;
+    }
+    double secs = stat->nsec / 1e9;
+    double mib = stat->bytes / (1024.0 * 1024.0);
+    dprintf(2, "pipe %i (%s -> %s): %llu bytes in %.3f s, %.1f MiB/s\n",
+            pipe_num, from, to, stat->bytes, secs, mib / secs);
+  }
+  munmap(job->pipe_stats, sizeof(pipe_stat_t) * (job->num_progs - 1));
+  job->pipe_stats = NULL;
 }
 
 void handler_SIGINT(int signum) {
@@ -92,6 +204,7 @@ void insert_job(job_t *job_to_insert) {
       // feel free to destroy its struct and put our new struct in there,
       //  feels like we recreated OOP with this one
       if (!job_array[i]->can_be_removed || job_to_insert != job_array[i]) {
+        report_pipe_stats(job_array[i]);
         job_deconstructor(job_array[i]);
         free(job_array[i]);
         job_array[i] = NULL;
@@ -192,9 +305,14 @@ void send_job_foreground(job_t *bg_job) {
   for (int i = 0; i < bg_job->pid_idx; i++) {
     kill(bg_job->pid[i], SIGCONT);
   }
+  // the relays got stopped along with everyone else
+  for (int i = 0; i < bg_job->num_relays; i++) {
+    kill(bg_job->relay_pid[i], SIGCONT);
+  }
   // give process group terminal control and let us wait for it,
   // after we are done waiting, check if it was stopped, if so,
   // we must put it back in our jobs list
+  int stopped = 0;
   for (int i = 0; i < bg_job->pid_idx; i++) {
     int status = -1;
     if (!batch_mode)
@@ -203,15 +321,22 @@ void send_job_foreground(job_t *bg_job) {
     if (!batch_mode)
       tcsetpgrp(STDIN_FILENO, getpid());
     if (WIFSTOPPED(status)) {
+      stopped = 1;
       send_job_background(bg_job);
       bg_job->can_be_removed = 1;
       killpg(bg_job->pid[0], SIGTSTP);
     } else if (WIFEXITED(status)) {
+      last_status = WEXITSTATUS(status);
       if (WEXITSTATUS(status) == 127) {
         printf("Command %s not found!\n", bg_job->arg_list[i][0]);
       }
+    } else if (WIFSIGNALED(status)) {
+      last_status = 128 + WTERMSIG(status);
     }
   }
+  if (!stopped) {
+    report_pipe_stats(bg_job);
+  }
   bg_job->can_be_removed = 0;
 }
 
@@ -311,6 +436,7 @@ void fg(char **args, int arg_count) {
     int job_loc = find_job(0, 1);
     if (job_loc == -1) {
       printf("Job not found!\n");
+      last_status = 1;
     }
     if (job_loc >= 0) {
       send_job_foreground(job_array[job_loc]);
@@ -320,10 +446,12 @@ void fg(char **args, int arg_count) {
     int arg_val = atoi(args[1]);
     if (arg_val == 0) {
       printf("Job value not understood!\n");
+      last_status = 1;
     }
     int job_loc = find_job(arg_val, 0);
     if (job_loc == -1) {
       printf("Job not found!\n");
+      last_status = 1;
     }
     if (job_loc >= 0) {
       send_job_foreground(job_array[job_loc]);
@@ -337,6 +465,7 @@ void bg(char **args, int arg_count) {
     int job_loc = find_fgjob(0, 1);
     if (job_loc == -1) {
       printf("Job not found!\n");
+      last_status = 1;
     }
     if (job_loc >= 0) {
       job_t *tmp_ptr = job_array[job_loc];
@@ -350,10 +479,12 @@ void bg(char **args, int arg_count) {
     int arg_val = atoi(args[1]);
     if (arg_val == 0) {
       printf("Job value not understood!\n");
+      last_status = 1;
     }
     int job_loc = find_fgjob(arg_val, 0);
     if (job_loc == -1) {
       printf("Job value not found!\n");
+      last_status = 1;
     }
     if (job_loc >= 0) {
       job_t *tmp_ptr = job_array[job_loc];
@@ -365,6 +496,41 @@ void bg(char **args, int arg_count) {
   }
 }
 
+// checks if any job in the jobs list still has a process which hasn't been
+// reaped, used to decide if we can exec in place of the shell
+int jobs_pending() {
+  for (int i = 0; i < num_jobs; i++) {
+    for (int proc_id = 0; proc_id < job_array[i]->pid_idx; proc_id++) {
+      int stat = -10;
+      if (waitpid(job_array[i]->pid[proc_id], &stat, WNOHANG) == 0) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// reports the pipe stats of background jobs whose processes have all
+// finished, checked before every line so the report shows up about when the
+// job is done rather than when its slot gets reused
+void report_finished_jobs() {
+  for (int i = 0; i < num_jobs; i++) {
+    if (job_array[i] == NULL || job_array[i]->pipe_stats == NULL) {
+      continue;
+    }
+    int all_finished = 1;
+    for (int proc_id = 0; proc_id < job_array[i]->pid_idx; proc_id++) {
+      int stat = -10;
+      if (waitpid(job_array[i]->pid[proc_id], &stat, WNOHANG) == 0) {
+        all_finished = 0;
+      }
+    }
+    if (all_finished) {
+      report_pipe_stats(job_array[i]);
+    }
+  }
+}
+
 // wrapper function to print out all the jobs
 void print_jobs(int out_fd) {
   for (int i = 0; i < num_jobs; i++) {
@@ -384,22 +550,209 @@ void print_jobs(int out_fd) {
     }
   }
 }
+// creates a pipe whose fds don't leak into anything we exec, and grows it to
+// pipe_size if one was set. set already checked pipe-max-size, but growing can
+// still fail once the user hits pipe-user-pages-soft, in which case the pipe
+// keeps the default size and we say so
+int make_pipe(int fds[2]) {
+  if (pipe2(fds, O_CLOEXEC) == -1) {
+    return -1;
+  }
+  if (pipe_size > 0 && fcntl(fds[1], F_SETPIPE_SZ, pipe_size) == -1 &&
+      !pipe_size_warned) {
+    dprintf(2, "nish: couldn't grow pipe to %i bytes (%s), using default\n",
+            pipe_size, strerror(errno));
+    pipe_size_warned = 1;
+  }
+  return 0;
+}
+
+// body of a relay process, moves everything from in_fd to out_fd with splice
+// so the data never gets copied through us, and keeps stat up to date as it
+// goes. Timing starts from the first chunk to arrive, so a slow starting
+// producer doesn't drag the throughput down. Polls the write side too, so a
+// reader that exits gets noticed even while the writer is quiet
+void relay_pipe(int in_fd, int out_fd, pipe_stat_t *stat) {
+  struct timespec start, now;
+  int started = 0;
+  struct pollfd fds[2];
+  fds[0].fd = in_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = out_fd;
+  fds[1].events = 0;
+  while (1) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    // nobody left to read what we would move
+    if (fds[1].revents & (POLLERR | POLLHUP)) {
+      break;
+    }
+    if (!(fds[0].revents & (POLLIN | POLLHUP))) {
+      continue;
+    }
+    ssize_t moved =
+        splice(in_fd, NULL, out_fd, NULL, RELAY_CHUNK, SPLICE_F_MOVE);
+    if (moved == -1 && errno == EINTR) {
+      continue;
+    }
+    // EOF from the writer, or EPIPE from a reader that went away
+    if (moved <= 0) {
+      break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!started) {
+      start = now;
+      started = 1;
+    }
+    stat->bytes += moved;
+    stat->nsec = (now.tv_sec - start.tv_sec) * 1000000000LL +
+                 (now.tv_nsec - start.tv_nsec);
+  }
+}
+
+// puts a relay between stage idx and the next one so we can count what goes
+// through, takes ownership of in_fd and returns the fd the next stage should
+// read from
+int start_relay(job_t *curr_job, int idx, int in_fd, pid_t pgid) {
+  int out_fds[2];
+  if (make_pipe(out_fds) == -1) {
+    perror("failure creating pipe");
+    exit(-1);
+  }
+  curr_job->pipe_stats[idx].active = 1;
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(out_fds[0]);
+    // with no group yet (the stages before us were builtins) we wait for
+    // main to move us into the next stage's group
+    if (!non_interactive && pgid != 0) {
+      setpgid(0, pgid);
+    }
+    // behave like the stages around us for ^C and ^Z, and treat a closed
+    // reader as the end rather than dying before the count is in
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN);
+    relay_pipe(in_fd, out_fds[1], &curr_job->pipe_stats[idx]);
+    exit(0);
+  } else if (pid < 0) {
+    perror("Forking failed, fork this!\n");
+    exit(-1);
+  }
+  curr_job->relay_pid[curr_job->num_relays] = pid;
+  curr_job->num_relays += 1;
+  close(in_fd);
+  close(out_fds[1]);
+  return out_fds[0];
+}
+
+// parses sizes like 65536, 512K or 1M
+int parse_size(char *str) {
+  char *end;
+  int shift = 0;
+  long size = strtol(str, &end, 10);
+  if (end == str || size < 0) {
+    return -1;
+  }
+  if (*end == 'k' || *end == 'K') {
+    shift = 10;
+    end++;
+  } else if (*end == 'm' || *end == 'M') {
+    shift = 20;
+    end++;
+  } else if (*end == 'g' || *end == 'G') {
+    shift = 30;
+    end++;
+  }
+  // check before shifting so a huge value can't overflow
+  if (*end != '\0' || size > (0x7fffffff >> shift)) {
+    return -1;
+  }
+  return size << shift;
+}
+
+// set builtin, with no arguments prints the settings, otherwise takes
+// pipesize=SIZE and pipestats=on|off. Returns 1 if any option was bad
+int set_option(char **args, int arg_count, int out_fd) {
+  int status = 0;
+  if (arg_count == 1) {
+    if (pipe_size > 0) {
+      dprintf(out_fd, "pipesize=%i\n", pipe_size);
+    } else {
+      dprintf(out_fd, "pipesize=default\n");
+    }
+    dprintf(out_fd, "pipestats=%s\n", pipe_stats ? "on" : "off");
+    return 0;
+  }
+  for (int i = 1; i < arg_count; i++) {
+    if (strncmp(args[i], "pipesize=", 9) == 0) {
+      int size = parse_size(args[i] + 9);
+      if (size < 0) {
+        dprintf(2, "pipesize value not understood!\n");
+        status = 1;
+        continue;
+      }
+      if (size == 0) {
+        pipe_size = 0;
+        continue;
+      }
+      // try it out on a throwaway pipe, the kernel rounds up to a power of
+      // two number of pages so keep whatever it actually gave us
+      int test_fds[2];
+      if (pipe2(test_fds, O_CLOEXEC) == -1) {
+        perror("failure creating pipe");
+        status = 1;
+        continue;
+      }
+      int actual = fcntl(test_fds[1], F_SETPIPE_SZ, size);
+      if (actual == -1) {
+        perror("pipesize");
+        status = 1;
+      } else {
+        pipe_size = actual;
+      }
+      close(test_fds[0]);
+      close(test_fds[1]);
+    } else if (strcmp(args[i], "pipestats=on") == 0) {
+      pipe_stats = 1;
+    } else if (strcmp(args[i], "pipestats=off") == 0) {
+      pipe_stats = 0;
+    } else {
+      dprintf(2, "set option %s not understood!\n", args[i]);
+      status = 1;
+    }
+  }
+  return status;
+}
+
 // function which when give a job struct, forks and execs all the processes in
 // the job, and sets their pipe file descriptors
 int run_command(char **args, job_t *curr_job, int input_fd, int output_fd,
                 pid_t pgid) {
   pid_t pid;
+  // flush anything we printf'ed so the child doesn't print it a second time
+  // when it exits
+  fflush(stdout);
   // create the process for the child
   pid = fork();
   if (pid == 0) {
-    setpgid(0, pgid);
+    // without job control the stages stay in the caller's process group, the
+    // same as sh -c, so they keep the terminal it gave us
+    if (!non_interactive) {
+      setpgid(0, pgid);
+    }
 
-    // setup the child's input and output streams
-    if (input_fd != 0) {
+    // setup the child's input and output streams, -1 means keep ours
+    if (input_fd != -1) {
       dup2(input_fd, 0);
       close(input_fd);
     }
-    if (output_fd != 1) {
+    if (output_fd != -1) {
       dup2(output_fd, 1);
       close(output_fd);
     }
@@ -424,6 +777,57 @@ int run_command(char **args, job_t *curr_job, int input_fd, int output_fd,
   return pid;
 }
 
+// the last command of a -c string doesn't need nish around afterwards, so
+// rather than forking and waiting on it we become it, only returns on
+// failure the same way the child in run_command would
+void exec_in_place(char **args) {
+  fflush(stdout);
+  execvp(args[0], args);
+  if (errno == ENOENT) {
+    printf("Command %s not found!\n", args[0]);
+    exit(127);
+  }
+  perror(args[0]);
+  exit(126);
+}
+
+// hands back the next line for the non-interactive modes, split off of the
+// -c string when cmd_pos is set and read from stdin otherwise. is_last is set
+// when nothing but whitespace follows the line. Returns NULL at the end
+char *next_line(char **cmd_pos, int *is_last) {
+  *is_last = 0;
+  if (*cmd_pos == NULL) {
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t nread = getline(&line, &len, stdin);
+    if (nread == -1) {
+      free(line);
+      return NULL;
+    }
+    if (nread > 0 && line[nread - 1] == '\n') {
+      line[nread - 1] = '\0';
+    }
+    return line;
+  }
+  if (**cmd_pos == '\0') {
+    return NULL;
+  }
+  char *start = *cmd_pos;
+  char *end = strchr(start, '\n');
+  if (end == NULL) {
+    end = start + strlen(start);
+    *cmd_pos = end;
+  } else {
+    *cmd_pos = end + 1;
+  }
+  char *rest = *cmd_pos;
+  while (*rest == ' ' || *rest == '\t' || *rest == '\n') {
+    rest++;
+  }
+  *is_last = (*rest == '\0');
+  return strndup(start, end - start);
+}
+
 void print_history(char *path_str, int out_fd) {
   struct stat buf;
   if (!stat(path_str, &buf)) {
@@ -446,30 +850,9 @@ void print_history(char *path_str, int out_fd) {
   }
 }
 
-int main(int argc, char *argv[]) {
-  // char* curr_line = NULL;
-  foreground_job = NULL;
-  cwd = (char *)malloc(256 * sizeof(char));
-  // size_t len = 0;
-  ssize_t nread;
-  int buffer_size = 32;
-  int batch_mode = 0;
-  // check if we are in batch mode
-  if (argc == 2) {
-    struct stat buf;
-    if (!stat(argv[1], &buf)) {
-      FILE *fp;
-      fp = freopen(argv[1], "r", stdin);
-      if (fp == NULL) {
-        perror("freopen returned NULL");
-        exit(-1);
-      }
-      batch_mode = 1;
-    } else {
-      perror("batch file not found");
-      exit(-1);
-    }
-  }
+// history file, signal handling and terminal control, everything the -c and
+// -s modes skip
+void interactive_setup() {
   struct stat buf;
   if (stat(".nishistory", &buf) == -1) {
     printf("Opening history!\n");
@@ -518,31 +901,102 @@ int main(int argc, char *argv[]) {
       exit(-1);
     }
   }
-  // main shell loop
   using_history();
   read_history(".nishistory");
+}
+
+// makes sure 0, 1 and 2 are open, a caller that closed one (cmd <&-) would
+// otherwise have our own pipes handed out as stdin or stdout
+void open_std_fds() {
+  for (int fd = 0; fd <= 2; fd++) {
+    if (fcntl(fd, F_GETFD) == -1) {
+      // open gives back the lowest free fd, which is this one
+      open("/dev/null", O_RDWR);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  open_std_fds();
+  // char* curr_line = NULL;
+  foreground_job = NULL;
+  cwd = (char *)malloc(256 * sizeof(char));
+  // size_t len = 0;
+  ssize_t nread;
+  int buffer_size = 32;
+  // where -c gets its lines from, stays NULL for -s
+  char *cmd_pos = NULL;
+  // check for -c and -s before we try for batch mode
+  if (argc >= 2 && strcmp(argv[1], "-c") == 0) {
+    if (argc < 3) {
+      dprintf(2, "nish: -c requires an argument\n");
+      exit(2);
+    }
+    cmd_pos = argv[2];
+    non_interactive = 1;
+    batch_mode = 1;
+  } else if (argc >= 2 && strcmp(argv[1], "-s") == 0) {
+    non_interactive = 1;
+    batch_mode = 1;
+  } else if (argc == 2) {
+    struct stat buf;
+    if (!stat(argv[1], &buf)) {
+      FILE *fp;
+      fp = freopen(argv[1], "r", stdin);
+      if (fp == NULL) {
+        perror("freopen returned NULL");
+        exit(-1);
+      }
+      batch_mode = 1;
+    } else {
+      perror("batch file not found");
+      exit(-1);
+    }
+  }
+  // none of the interactive setup matters when we are just running commands
+  // for someone else
+  if (!non_interactive) {
+    interactive_setup();
+  } else if (cmd_pos == NULL) {
+    // commands and their input share stdin with -s, so only take the line
+    // we run off of the fd and leave the rest for the commands
+    setvbuf(stdin, NULL, _IONBF, 0);
+  }
   if (getcwd(cwd, 256) == NULL) {
     perror("getcwd() error");
     exit(EXIT_FAILURE);
   }
   char prompt[259];
+  // main shell loop
   while (1) {
     // malloc space for our programs for the split_line_to_programs function
     char **programs = malloc(buffer_size * sizeof(char *));
     if (programs == NULL) {
       exit(-1);
     }
-    snprintf(prompt, sizeof prompt, "nish %s>", cwd);
-    // get currentline and check if EOF
-    char *curr_line = readline(prompt);
-    nread = 0;
-    if (curr_line != NULL) {
+    report_finished_jobs();
+    pipe_size_warned = 0;
+    char *curr_line;
+    int is_last_line = 0;
+    if (non_interactive) {
+      curr_line = next_line(&cmd_pos, &is_last_line);
+      if (curr_line == NULL) {
+        exit(last_status);
+      }
       nread = strlen(curr_line);
     } else {
-      write_history(".nishistory");
-      exit(0);
+      snprintf(prompt, sizeof prompt, "nish %s>", cwd);
+      // get currentline and check if EOF
+      curr_line = readline(prompt);
+      nread = 0;
+      if (curr_line != NULL) {
+        nread = strlen(curr_line);
+      } else {
+        write_history(".nishistory");
+        exit(0);
+      }
+      add_history(curr_line);
     }
-    add_history(curr_line);
     // clean up whitespace and the such
     while (nread > 0 &&
            (curr_line[nread - 1] == ' ' || curr_line[nread - 1] == '\t' ||
@@ -582,9 +1036,26 @@ int main(int argc, char *argv[]) {
     if (curr_job->arg_list == NULL) {
       exit(-1);
     }
+    curr_job->num_relays = 0;
+    curr_job->relay_pid = NULL;
+    curr_job->pipe_stats = NULL;
+    if (pipe_stats && num_programs > 1) {
+      curr_job->relay_pid = malloc(sizeof(pid_t) * (num_programs - 1));
+      if (curr_job->relay_pid == NULL) {
+        exit(-1);
+      }
+      curr_job->pipe_stats =
+          mmap(NULL, sizeof(pipe_stat_t) * (num_programs - 1),
+               PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+      if (curr_job->pipe_stats == MAP_FAILED) {
+        perror("mmap for pipe stats");
+        exit(-1);
+      }
+    }
     // create a pipe and pgid variables for pipes
     int first_real_process = 1;
-    int input_fd = 0;
+    // -1 rather than 0 and 1 for no pipe, stdin and stdout are just fds
+    int input_fd = -1;
     pid_t gpid = 0;
     int pipe_fds[2];
     // for as many processes as the user puts, let us fork/exec and connect
@@ -607,14 +1078,23 @@ int main(int argc, char *argv[]) {
       // if the user provides a real command, check if built-in
       if (num_args >= 1) {
         if (idx < num_programs - 1) {
-          if (pipe(pipe_fds) == -1) {
+          if (make_pipe(pipe_fds) == -1) {
             perror("failure creating pipe");
             exit(-1);
           }
         } else {
-          pipe_fds[1] = 1;
+          pipe_fds[0] = -1;
+          pipe_fds[1] = -1;
         }
+        // where builtins write to
+        int out_fd = pipe_fds[1] != -1 ? pipe_fds[1] : 1;
         if (strncmp(args[0], "exit", 4) == 0) {
+          // exit N wins, otherwise -c and -s pass on the last status, grab it
+          // before args gets freed below
+          int exit_status = non_interactive ? last_status : 0;
+          if (num_args >= 2) {
+            exit_status = atoi(args[1]) & 0xff;
+          }
           // clean up code
           free(programs);
           programs = NULL;
@@ -627,12 +1107,18 @@ int main(int argc, char *argv[]) {
             job_array[i] = NULL;
           }
           free(cwd);
-          write_history(".nishistory");
-          exit(0);
+          if (!non_interactive) {
+            write_history(".nishistory");
+          }
+          exit(exit_status);
         } else if (strncmp(args[0], "history", 7) == 0) {
-          write_history(".nishistory");
-          print_history(".nishistory", pipe_fds[1]);
+          if (!non_interactive) {
+            write_history(".nishistory");
+          }
+          print_history(".nishistory", out_fd);
+          last_status = 0;
         } else if (strncmp(args[0], "cd", 2) == 0) {
+          last_status = 1;
           if (num_args != 2) {
             printf("cd requires a single argument\n");
           } else {
@@ -640,24 +1126,39 @@ int main(int argc, char *argv[]) {
               printf("Failed to open {%s}\n", args[1]);
             } else {
               getcwd(cwd, 256);
+              last_status = 0;
             }
           }
         } else if (strncmp(args[0], "jobs", 4) == 0) {
+          last_status = 0;
           if (num_args != 1) {
             printf("jobs takes in no arguments\n");
+            last_status = 1;
           }
-          print_jobs(pipe_fds[1]);
+          print_jobs(out_fd);
         } else if (strncmp(args[0], "fg", 2) == 0) {
+          // fg and bg set the status themselves when they can't find the job
+          last_status = 0;
           if (num_args != 1 && num_args != 2) {
             printf("fg takes in either one or no arguments\n");
+            last_status = 1;
           }
           fg(args, num_args);
         } else if (strncmp(args[0], "bg", 2) == 0) {
+          last_status = 0;
           if (num_args != 1 && num_args != 2) {
             printf("bg takes in either one or no arguments\n");
+            last_status = 1;
           }
           bg(args, num_args);
+        } else if (strcmp(args[0], "set") == 0) {
+          last_status = set_option(args, num_args, out_fd);
         } else {
+          // last command of -c with nothing left to wait on, no need to fork
+          if (is_last_line && num_programs == 1 && !is_background &&
+              !jobs_pending()) {
+            exec_in_place(args);
+          }
           // get the pid of the process just cfrreated
           pid_t temp_pid =
               run_command(args, curr_job, input_fd, pipe_fds[1], gpid);
@@ -667,16 +1168,33 @@ int main(int argc, char *argv[]) {
           if (first_real_process) {
             gpid = temp_pid;
             first_real_process = 0;
+            // relays started after leading builtins had no group to join
+            for (int i = 0; i < curr_job->num_relays && !non_interactive;
+                 i++) {
+              setpgid(curr_job->relay_pid[i], gpid);
+            }
           }
         }
-        if (pipe_fds[1] != 1) {
+        // the child has its own copies by now, if we hang on to ours the
+        // readers further down never see EOF
+        if (input_fd != -1) {
+          close(input_fd);
+        }
+        if (pipe_fds[1] != -1) {
           close(pipe_fds[1]);
         }
         // set our input fd as the read end of the pipe created in
         // the previous iteration, like reversing a linked list
         input_fd = pipe_fds[0];
+        if (curr_job->pipe_stats != NULL && input_fd != -1) {
+          input_fd = start_relay(curr_job, idx, input_fd, gpid);
+        }
       }
     }
+    // a trailing empty stage leaves the last read end with nobody to hand it to
+    if (input_fd != -1) {
+      close(input_fd);
+    }
     // send the job to the foreground or background
     if (!is_background) {
       send_job_foreground(curr_job);